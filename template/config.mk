@@ -5,6 +5,8 @@
 TARGET := draft
 PROFILE ?= debug
 SANITIZER ?= none
+TRACE ?= no
+HEAPPROF ?= no
 
 # ------------------------------------------------------------------------------
 # Tools & Compilers
@@ -28,16 +30,23 @@ TARGETS_DIR := target
 
 LOGFILE ?= log.txt
 DEBUG_LOGFILE ?= gdb.txt
+TRACE_FILE ?= trace.json
+HEAPPROF_FILE ?= heapprof
 # ------------------------------------------------------------------------------
 # Base Compiler & Linker Flags
 # ------------------------------------------------------------------------------
 CXXFLAGS_BASE := -std=c++23
 WFLAGS := -Wall -Wextra -Wpedantic -Werror
 DFLAGS := -O0 -ggdb3 -fno-omit-frame-pointer
+PFLAGS := -ggdb3 -fno-omit-frame-pointer -mno-omit-leaf-frame-pointer
 
 # Libraries
 LIBS :=
 
+# Heap profiler (src/heapprof.*): mean bytes between sampled allocations
+HEAPPROF_SAMPLE ?= 524288
+HEAPPROF_LDFLAGS := -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free -lm
+
 # Sanitizer definitions
 SANITIZE_UB := undefined shift alignment bounds enum return unreachable object-size null vptr
 SANITIZE_ADDRESS := -fsanitize=address $(addprefix -fsanitize=,$(SANITIZE_UB))
@@ -0,0 +1,175 @@
+#pragma once
+/**
+ * @file arena.hpp
+ * @brief Monotonic arena (std::pmr::memory_resource) with recyclable chunks.
+ */
+#if defined(__cplusplus)
+#ifndef USE_PCH
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#endif
+
+#include "core/typedefs.hpp"
+
+namespace core {
+using namespace typedefs;
+
+/**
+ * @brief Bump allocator over chunks taken from an upstream resource.
+ * Deallocation is a no-op; memory is reclaimed with rewind()/reset(), which keep
+ * the chunks for reuse, so a warmed-up arena no longer touches the upstream.
+ * Not thread-safe.
+ */
+class Arena final : public std::pmr::memory_resource {
+	struct Chunk;
+
+      public:
+	struct Marker {
+		Chunk     *chunk{};
+		std::byte *ptr{};
+	};
+
+	static constexpr usize default_chunk_size = 16 * 1024;
+
+	[[nodiscard]] explicit Arena(usize chunk_size = default_chunk_size,
+	                             std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) noexcept
+	    : upstream_(upstream),
+	      chunk_size_(chunk_size)
+	{ }
+
+	~Arena() override { release(); }
+
+	Arena(const Arena &)            = delete;
+	Arena(Arena &&)                 = delete;
+	Arena &operator=(const Arena &) = delete;
+	Arena &operator=(Arena &&)      = delete;
+
+	/** @brief Current position, to be handed back to rewind(). */
+	[[nodiscard]] auto mark() const noexcept -> Marker { return {cur_, ptr_}; }
+
+	/** @brief Frees everything allocated since @m was taken. */
+	void rewind(Marker m) noexcept
+	{
+		cur_ = m.chunk;
+		ptr_ = m.ptr;
+		end_ = cur_ ? cur_->end() : nullptr;
+	}
+
+	void reset() noexcept { rewind({}); }
+
+	/** @brief Returns all chunks to the upstream resource. */
+	void release() noexcept
+	{
+		while (head_) {
+			Chunk *next = head_->next;
+			upstream_->deallocate(head_, head_->size, alignof(std::max_align_t));
+			head_ = next;
+		}
+		rewind({});
+	}
+
+	[[nodiscard]] auto capacity() const noexcept -> usize
+	{
+		usize total = 0;
+		for (const Chunk *c = head_; c; c = c->next)
+			total += c->size - sizeof(Chunk);
+		return total;
+	}
+
+      private:
+	struct Chunk {
+		Chunk *next;
+		usize  size; /* including this header */
+
+		auto begin() noexcept -> std::byte * { return reinterpret_cast<std::byte *>(this + 1); }
+		auto end() noexcept -> std::byte * { return reinterpret_cast<std::byte *>(this) + size; }
+	};
+
+	void *do_allocate(usize bytes, usize align) override
+	{
+		for (;;) {
+			void *p     = ptr_;
+			usize space = static_cast<usize>(end_ - ptr_);
+			if (ptr_ && std::align(align, bytes, p, space)) {
+				ptr_ = static_cast<std::byte *>(p) + bytes;
+				return p;
+			}
+			next_chunk(bytes + align);
+		}
+	}
+
+	void do_deallocate(void *, usize, usize) override { }
+
+	[[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	/* Moves to the next retained chunk, or links a new one in front of it if too small */
+	void next_chunk(usize min_size)
+	{
+		Chunk *&link = cur_ ? cur_->next : head_;
+		Chunk  *next = link;
+		if (!next || next->size - sizeof(Chunk) < min_size) {
+			const usize size = std::max(chunk_size_, min_size + sizeof(Chunk));
+			void       *mem  = upstream_->allocate(size, alignof(std::max_align_t));
+			next = link = ::new (mem) Chunk{next, size};
+		}
+		cur_ = next;
+		ptr_ = next->begin();
+		end_ = next->end();
+	}
+
+	std::pmr::memory_resource *upstream_;
+	usize                      chunk_size_;
+	Chunk                     *head_{};
+	Chunk                     *cur_{};
+	std::byte                 *ptr_{};
+	std::byte                 *end_{};
+};
+
+/**
+ * @brief The calling thread's arena. Its chunks live until the thread exits.
+ */
+inline Arena &thread_arena()
+{
+	thread_local Arena arena;
+	return arena;
+}
+
+/**
+ * @brief Memory for short-lived buffers: @resource if given, otherwise the
+ * calling thread's arena, rewound when the scope ends. Scopes must nest.
+ */
+class ScratchScope {
+      public:
+	[[nodiscard]] explicit ScratchScope(std::pmr::memory_resource *resource = nullptr) noexcept
+	    : arena_(resource ? nullptr : &thread_arena()),
+	      mark_(arena_ ? arena_->mark() : Arena::Marker{}),
+	      resource_(resource ? resource : arena_)
+	{ }
+
+	~ScratchScope()
+	{
+		if (arena_)
+			arena_->rewind(mark_);
+	}
+
+	ScratchScope(const ScratchScope &)            = delete;
+	ScratchScope(ScratchScope &&)                 = delete;
+	ScratchScope &operator=(const ScratchScope &) = delete;
+	ScratchScope &operator=(ScratchScope &&)      = delete;
+
+	[[nodiscard]] auto resource() const noexcept -> std::pmr::memory_resource * { return resource_; }
+
+      private:
+	Arena                     *arena_;
+	Arena::Marker              mark_;
+	std::pmr::memory_resource *resource_;
+};
+
+} /* namespace core */
+#endif
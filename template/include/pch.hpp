@@ -2,12 +2,15 @@
 
 #if defined(__cplusplus)
 /* threading */
+// #include <atomic>
 // #include <condition_variable>
 // #include <future>
 // #include <mutex>
+// #include <thread>
 
 /* containers */
 // #include <deque>
+// #include <memory_resource>
 // #include <string>
 // #include <unordered_map>
 // #include <vector>
@@ -38,3 +41,4 @@
 
 /* Project specific */
 #include "util/logger.hpp"
+#include "util/trace.hpp"
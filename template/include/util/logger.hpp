@@ -11,14 +11,18 @@
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <memory_resource>
 #include <mutex>
 #include <optional>
 #include <source_location>
 #include <sstream>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 #endif
 
+#include "core/arena.hpp"
 #include "core/typedefs.hpp"
 
 using namespace typedefs;
@@ -106,8 +110,6 @@ static inline std::string to_string(std::source_location const source)
 	                   source.function_name(), source.line());
 }
 
-inline std::string to_string(auto tp) { return std::format("{:%F %T %Z}", tp); }
-
 static inline std::string_view to_string(LogLevel lvl)
 {
 	switch (lvl) {
@@ -232,21 +234,33 @@ using FileSink_ST = FileSink<details::null_mutex>;
 
 using sink_ptr = std::shared_ptr<logger::sinks::Sink>;
 
+/**
+ * @brief Logger whose buffers all come from @resource.
+ * With the default (nullptr), per-message buffers come from the calling thread's
+ * recycled core::Arena and the logger's own state from std::pmr::get_default_resource().
+ * A given @resource is used for both and must be thread-safe if the logger is shared.
+ */
 class Logger {
       public:
 
-	explicit Logger(std::string name, LogLevel level = LogLevel::Error)
-	    : level_(level), name_(std::move(name))
+	explicit Logger(std::string_view name, LogLevel level = LogLevel::Error,
+	                std::pmr::memory_resource *resource = nullptr)
+	    : resource_(resource), sinks_(state_resource(resource)), level_(level), name_(name, state_resource(resource))
 	{ }
 
 	template <typename It>
-	Logger(std::string name, It begin, It end, LogLevel level = LogLevel::Error)
-	    : sinks_(begin, end), level_(level), name_(std::move(name))
+	Logger(std::string_view name, It begin, It end, LogLevel level = LogLevel::Error,
+	       std::pmr::memory_resource *resource = nullptr)
+	    : resource_(resource), sinks_(begin, end, state_resource(resource)), level_(level),
+	      name_(name, state_resource(resource))
 	{ }
 
-	Logger(std::string name, sink_ptr sink, LogLevel level = LogLevel::Error)
-	    : sinks_{std::move(sink)}, level_(level), name_(std::move(name))
-	{ }
+	Logger(std::string_view name, sink_ptr sink, LogLevel level = LogLevel::Error,
+	       std::pmr::memory_resource *resource = nullptr)
+	    : Logger(name, level, resource)
+	{
+		sinks_.push_back(std::move(sink));
+	}
 
 	void add_sink(sink_ptr sink) noexcept
 	{
@@ -262,13 +276,15 @@ class Logger {
 
 	void set_LogLevel(LogLevel level) { level_ = level; }
 	[[nodiscard]] auto should_log(LogLevel level) const -> bool { return level >= level_; }
-	[[nodiscard]] auto name() const -> const std::string & { return name_; }
+	[[nodiscard]] auto name() const -> const std::pmr::string & { return name_; }
 
 	template <typename... Args>
 	void log(LogLevel level, std::format_string<Args...> fmt, Args &&...args) noexcept
 	{
-		if (should_log(level))
-			log_fmt(level, fmt_rt(fmt, std::forward<Args>(args)...));
+		if (!should_log(level))
+			return;
+		core::ScratchScope scratch(resource_);
+		log_fmt(level, fmt_rt(scratch.resource(), fmt, std::forward<Args>(args)...));
 	}
 
 	void log(LogLevel lvl, std::string_view msg) noexcept
@@ -279,9 +295,13 @@ class Logger {
 
 	struct Stream {
 	      private:
+		using ostringstream = std::basic_ostringstream<char, std::char_traits<char>, std::pmr::polymorphic_allocator<char>>;
+
 		LogLevel                level_;
 		/*std::source_location    source_;*/
-		std::ostringstream      oss_;
+		/* Not thread-arena backed: a Stream may outlive a later one (heap, coroutine),
+		 * which would break ScratchScope nesting. The arena is only used inside log(). */
+		ostringstream           oss_;
 		Logger                 *logger_;
 
 	      public:
@@ -298,10 +318,11 @@ class Logger {
 		}
 
 		Stream(Logger *logger, LogLevel lvl /*, std::source_location src = std::source_location::current()*/)
-		    : level_(lvl), /*source_(src),*/ logger_(logger)
+		    : level_(lvl), /*source_(src),*/
+		      oss_(std::ios_base::out, state_resource(logger->resource_)), logger_(logger)
 		{ }
 
-		~Stream() { logger_->log(level_, oss_.str()/*, source_*/); }
+		~Stream() { logger_->log(level_, oss_.view()/*, source_*/); }
 	};
 
 	Stream stream(LogLevel level/*, std::source_location source = std::source_location::current()*/)
@@ -311,12 +332,21 @@ class Logger {
 
       private:
 
+	[[nodiscard]] static auto state_resource(std::pmr::memory_resource *resource) -> std::pmr::memory_resource *
+	{
+		return resource ? resource : std::pmr::get_default_resource();
+	}
+
 	void log_fmt(LogLevel level, std::string_view msg/*, std::source_location source = {}*/)
 	{
+		core::ScratchScope scratch(resource_);
+		std::pmr::string   formatted(scratch.resource());
+		formatted.reserve(msg.size() + 96);
+
 		std::lock_guard<std::mutex> lock(mtx_);
 
-		auto formatted = std::format( "[{}] ({}) {}[{}]{}: {}\n",
-			logger::details::to_string(logger::details::local_time(std::chrono::system_clock::now())),
+		std::format_to(std::back_inserter(formatted), "[{:%F %T %Z}] ({}) {}[{}]{}: {}\n",
+			logger::details::local_time(std::chrono::system_clock::now()),
 			name_,
 			logger::details::get_color(level),
 			logger::details::to_string(level),
@@ -330,18 +360,20 @@ class Logger {
 	}
 
 	template <typename... Args>
-	[[nodiscard]] auto fmt_rt(std::format_string<Args...> fmt, Args &&...args) noexcept -> std::string
+	[[nodiscard]] static auto fmt_rt(std::pmr::memory_resource *resource, std::format_string<Args...> fmt,
+	                                 Args &&...args) noexcept -> std::pmr::string
 	{
-		std::string msg;
+		std::pmr::string msg(resource);
 		/* TODO: handle exceptions */
 		std::vformat_to(std::back_inserter(msg), fmt.get(), std::make_format_args(args...));
 		return msg;
 	}
 
-	std::vector<sink_ptr> sinks_;
-	LogLevel              level_{LogLevel::Error};
-	std::mutex            mtx_;
-	std::string           name_;
+	std::pmr::memory_resource *resource_; /* nullptr: thread arena for messages */
+	std::pmr::vector<sink_ptr> sinks_;
+	LogLevel                   level_{LogLevel::Error};
+	std::mutex                 mtx_;
+	std::pmr::string           name_;
 };
 
 class LoggerRegistry {
@@ -365,7 +397,7 @@ class LoggerRegistry {
 	{
 		auto &self = inst();
 		std::lock_guard<std::mutex> lock(self.mtx_);
-		auto it = self.loggers_.find(std::string(name));
+		auto it = self.loggers_.find(name);
 		return (it != self.loggers_.end()) ? it->second : nullptr;
 	}
 
@@ -392,26 +424,35 @@ class LoggerRegistry {
       private:
 	LoggerRegistry() = default;
 
-	std::unordered_map<std::string, std::shared_ptr<Logger>> loggers_;
-	std::shared_ptr<Logger>                                  default_logger_;
-	std::mutex                                               mtx_;
+	/* Lets find() take a string_view without building a key */
+	struct name_hash {
+		using is_transparent = void;
+		auto operator()(std::string_view name) const noexcept -> usize { return std::hash<std::string_view>{}(name); }
+	};
+
+	std::pmr::unsynchronized_pool_resource pool_; /* guarded by mtx_ */
+	std::pmr::unordered_map<std::pmr::string, std::shared_ptr<Logger>, name_hash, std::equal_to<>> loggers_{&pool_};
+	std::shared_ptr<Logger>                                                                         default_logger_;
+	std::mutex                                                                                      mtx_;
 };
 
 namespace logger::factory {
 
 template <typename Mutex = sinks::details::null_mutex>
-inline std::shared_ptr<Logger> stdout_logger(std::string name, std::filesystem::path &path, bool force_flush = false)
+inline std::shared_ptr<Logger> stdout_logger(std::string_view name, std::filesystem::path &path, bool force_flush = false,
+                                             std::pmr::memory_resource *resource = nullptr)
 {
-	auto lg = std::make_shared<Logger>(std::move(name));
+	auto lg = std::make_shared<Logger>(name, LogLevel::Error, resource);
 	lg->add_sink(std::make_shared<logger::sinks::ostreamSink<Mutex>>(path, force_flush));
 	LoggerRegistry::register_logger(lg);
 	return lg;
 }
 
 template <typename Mutex = sinks::details::null_mutex>
-inline std::shared_ptr<Logger> file_logger(std::string name, const std::filesystem::path &file)
+inline std::shared_ptr<Logger> file_logger(std::string_view name, const std::filesystem::path &file,
+                                           std::pmr::memory_resource *resource = nullptr)
 {
-	auto lg = std::make_shared<Logger>(std::move(name));
+	auto lg = std::make_shared<Logger>(name, LogLevel::Error, resource);
 	lg->add_sink(std::make_shared<logger::sinks::FileSink<Mutex>>(file));
 	LoggerRegistry::register_logger(lg);
 	return lg;
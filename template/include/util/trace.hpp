@@ -0,0 +1,432 @@
+#pragma once /* trace */
+/**
+ * @file trace.hpp
+ * @brief Header-only scoped tracing with Chrome/Perfetto JSON export.
+ *
+ * Events are recorded into per-thread SPSC ring buffers, timestamped with the TSC
+ * (steady_clock on non-x86), and drained by a background thread into a JSON trace
+ * file loadable by chrome://tracing or ui.perfetto.dev.
+ *
+ * Enabled with `make TRACE=yes` (see config.mk). Otherwise every TRACE_* macro
+ * expands to nothing.
+ *
+ * Events recorded after trace::shutdown() (or after the Tracer's static
+ * destruction) are discarded.
+ *
+ * @warning Event and counter names are stored by pointer: pass string literals.
+ */
+#if defined(__cplusplus)
+#if defined(USE_TRACE)
+#ifndef USE_PCH
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#endif
+
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "core/typedefs.hpp"
+
+#ifndef TRACE_FILE
+#define TRACE_FILE "trace.json"
+#endif
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS (1U << 14) /* per thread, must be a power of 2 */
+#endif
+#ifndef TRACE_FLUSH_INTERVAL_MS
+#define TRACE_FLUSH_INTERVAL_MS 100
+#endif
+
+namespace trace::details {
+using namespace typedefs;
+
+static_assert(std::has_single_bit(static_cast<usize>(TRACE_BUFFER_EVENTS)),
+              "TRACE_BUFFER_EVENTS must be a power of 2");
+
+/**
+ * @brief Raw timestamp: TSC ticks on x86, steady_clock nanoseconds elsewhere.
+ */
+[[gnu::always_inline]] inline u64 ticks() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return static_cast<u64>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/* Clock origin taken at static initialization, so spans opened before the
+ * Tracer is lazily created still get a non-negative timestamp. */
+struct Origin {
+	u64                                   ticks = details::ticks();
+	std::chrono::steady_clock::time_point clock = std::chrono::steady_clock::now();
+};
+inline const Origin origin{};
+
+enum class EventType : u8 { Complete, Instant, Counter };
+
+struct Event {
+	const char *name;
+	u64         ts;
+	u64         arg; /* duration in ticks for spans, bit_cast<u64>(double) for counters */
+	EventType   type;
+};
+
+/**
+ * @brief Single-producer (owning thread) single-consumer (flusher) event ring.
+ */
+struct ThreadBuffer {
+	static constexpr u64 capacity = TRACE_BUFFER_EVENTS;
+
+	explicit ThreadBuffer(u32 tid) : tid_(tid) { }
+
+	[[gnu::always_inline]] void push(const Event &ev) noexcept
+	{
+		const u64 h = head_.load(std::memory_order_relaxed);
+		if (h - cached_tail_ >= capacity) {
+			cached_tail_ = tail_.load(std::memory_order_acquire);
+			if (h - cached_tail_ >= capacity) {
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		}
+		events_[h & (capacity - 1)] = ev;
+		head_.store(h + 1, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Consumer side: hands every pending event to @fn and releases the slots.
+	 */
+	template <typename Fn>
+	void drain(Fn &&fn)
+	{
+		u64       t = tail_.load(std::memory_order_relaxed);
+		const u64 h = head_.load(std::memory_order_acquire);
+		for (; t != h; ++t)
+			fn(events_[t & (capacity - 1)]);
+		tail_.store(t, std::memory_order_release);
+	}
+
+	[[nodiscard]] u64 take_dropped() noexcept { return dropped_.exchange(0, std::memory_order_relaxed); }
+	[[nodiscard]] u32 tid() const noexcept { return tid_; }
+
+	std::string       name_;     /* guarded by Tracer::mtx_ */
+	bool              named_{};  /* guarded by Tracer::mtx_ */
+	std::atomic<bool> retired_{};
+
+      private:
+	alignas(64) std::atomic<u64> head_{0};
+	u64                          cached_tail_{0}; /* producer-local */
+	alignas(64) std::atomic<u64> tail_{0};
+	std::atomic<u64>             dropped_{0};
+	u32                          tid_;
+	std::array<Event, capacity>  events_{};
+};
+
+inline thread_local ThreadBuffer *tls_buffer = nullptr;
+
+/* Set by Tracer::shutdown(). A namespace-scope atomic, unlike the Tracer, stays
+ * valid through static destruction. */
+inline std::atomic<bool> stopped{false};
+
+} /* namespace trace::details */
+
+namespace trace {
+
+class Tracer {
+      public:
+	static Tracer &inst()
+	{
+		static Tracer tracer(TRACE_FILE);
+		return tracer;
+	}
+
+	/**
+	 * @brief Creates and registers the calling thread's buffer.
+	 * Slow path, taken once per thread on its first event.
+	 */
+	details::ThreadBuffer *attach()
+	{
+		auto buf = std::make_shared<details::ThreadBuffer>(static_cast<details::u32>(::gettid()));
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			buffers_.push_back(buf);
+		}
+		/* Keeps the buffer alive for the thread and retires it on thread exit */
+		struct Owner {
+			std::shared_ptr<details::ThreadBuffer> buf;
+			~Owner()
+			{
+				details::tls_buffer = nullptr;
+				if (buf)
+					buf->retired_.store(true, std::memory_order_release);
+			}
+		};
+		static thread_local Owner owner;
+		owner.buf = buf;
+		return buf.get();
+	}
+
+	void set_thread_name(details::ThreadBuffer *buf, std::string_view name)
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		buf->name_  = name;
+		buf->named_ = false;
+	}
+
+	/**
+	 * @brief Synchronously writes every pending event to the trace file.
+	 */
+	void flush()
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		drain_locked();
+		ofs_.flush();
+	}
+
+	/**
+	 * @brief Stops the flusher, writes remaining events and closes the JSON array.
+	 * Later events are discarded. Idempotent; called automatically at static destruction.
+	 */
+	void shutdown()
+	{
+		details::stopped.store(true, std::memory_order_relaxed);
+		if (flusher_.joinable()) {
+			flusher_.request_stop();
+			flusher_.join();
+		}
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (!ofs_.is_open())
+			return;
+		drain_locked();
+		ofs_ << "\n]\n";
+		ofs_.close();
+	}
+
+	~Tracer() { shutdown(); }
+
+	Tracer(Tracer &&)                          = delete;
+	Tracer &operator=(Tracer &&)               = delete;
+	Tracer(const Tracer &)                     = delete;
+	auto operator=(const Tracer &) -> Tracer & = delete;
+
+      private:
+	explicit Tracer(const char *path)
+	    : ofs_(path, std::ios::trunc),
+	      pid_(::getpid())
+	{
+		if (!ofs_.is_open()) {
+			std::cerr << "Failed to open trace file: " << path << '\n';
+			return;
+		}
+		ofs_ << '[';
+		flusher_ = std::jthread([this](std::stop_token stoken) {
+			std::mutex                  wait_mtx;
+			std::unique_lock<std::mutex> wait_lock(wait_mtx);
+			while (!stoken.stop_requested()) {
+				cv_.wait_for(wait_lock, stoken, std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS),
+				             [] { return false; });
+				flush();
+			}
+		});
+	}
+
+	/* Ticks are converted to ns with the ratio observed since the origin,
+	 * which converges quickly for an invariant TSC. */
+	void calibrate()
+	{
+		const auto ns    = std::chrono::steady_clock::now() - details::origin.clock;
+		const auto ticks = details::ticks() - details::origin.ticks;
+		if (ticks > 0 && ns.count() > 0)
+			ns_per_tick_ = static_cast<double>(ns.count()) / static_cast<double>(ticks);
+	}
+
+	[[nodiscard]] double to_us(details::s64 ticks) const { return static_cast<double>(ticks) * ns_per_tick_ / 1000.0; }
+
+	void write_escaped(std::string_view str)
+	{
+		static constexpr char hex[] = "0123456789abcdef";
+		for (const char c : str) {
+			const auto uc = static_cast<unsigned char>(c);
+			if (uc < 0x20) {
+				ofs_ << "\\u00" << hex[uc >> 4] << hex[uc & 0xf];
+				continue;
+			}
+			if (c == '"' || c == '\\')
+				ofs_ << '\\';
+			ofs_ << c;
+		}
+	}
+
+	void write_header(const char *name, char phase, details::u64 ts, details::u32 tid)
+	{
+		ofs_ << (first_ ? "\n" : ",\n") << "{\"name\":\"";
+		first_ = false;
+		write_escaped(name);
+		ofs_ << "\",\"ph\":\"" << phase << "\",\"ts\":" << to_us(static_cast<details::s64>(ts - details::origin.ticks)) << ",\"pid\":" << pid_
+		     << ",\"tid\":" << tid;
+	}
+
+	void write_event(const details::Event &ev, details::u32 tid)
+	{
+		using details::EventType;
+		switch (ev.type) {
+		case EventType::Complete:
+			write_header(ev.name, 'X', ev.ts, tid);
+			ofs_ << ",\"dur\":" << to_us(static_cast<details::s64>(ev.arg)) << '}';
+			break;
+		case EventType::Instant:
+			write_header(ev.name, 'i', ev.ts, tid);
+			ofs_ << ",\"s\":\"t\"}";
+			break;
+		case EventType::Counter:
+			write_header(ev.name, 'C', ev.ts, tid);
+			ofs_ << ",\"args\":{\"value\":" << std::bit_cast<double>(ev.arg) << "}}";
+			break;
+		}
+	}
+
+	void drain_locked()
+	{
+		if (!ofs_.is_open())
+			return;
+		calibrate();
+		ofs_ << std::fixed << std::setprecision(3);
+		for (auto &buf : buffers_) {
+			if (!buf->named_ && !buf->name_.empty()) {
+				ofs_ << (first_ ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid_
+				     << ",\"tid\":" << buf->tid() << ",\"args\":{\"name\":\"";
+				first_ = false;
+				write_escaped(buf->name_);
+				ofs_ << "\"}}";
+				buf->named_ = true;
+			}
+			/* Read before draining so a retired buffer is only dropped once empty */
+			const bool retired = buf->retired_.load(std::memory_order_acquire);
+			buf->drain([&](const details::Event &ev) { write_event(ev, buf->tid()); });
+			if (const auto dropped = buf->take_dropped())
+				std::cerr << "trace: dropped " << dropped << " events on tid " << buf->tid() << '\n';
+			if (retired)
+				buf.reset();
+		}
+		std::erase(buffers_, nullptr);
+	}
+
+	std::vector<std::shared_ptr<details::ThreadBuffer>> buffers_;
+	std::ofstream                                       ofs_;
+	bool                                                first_{true};
+	int                                                 pid_;
+	double                                              ns_per_tick_{1.0};
+	std::mutex                                          mtx_;
+	std::condition_variable_any                         cv_;
+	std::jthread                                        flusher_; /* last: joined before members die */
+};
+
+namespace details {
+
+[[gnu::always_inline]] inline void record(const Event &ev) noexcept
+{
+	if (stopped.load(std::memory_order_relaxed)) [[unlikely]]
+		return;
+	ThreadBuffer *buf = tls_buffer;
+	if (!buf) [[unlikely]]
+		buf = tls_buffer = Tracer::inst().attach();
+	buf->push(ev);
+}
+
+} /* namespace details */
+
+/**
+ * @brief RAII span, recorded as one complete ("X") event when it goes out of scope.
+ */
+class Span {
+      public:
+	[[gnu::always_inline]] explicit Span(const char *name) noexcept : name_(name), start_(details::ticks()) { }
+	[[gnu::always_inline]] ~Span()
+	{
+		const auto end = details::ticks();
+		details::record({name_, start_, end - start_, details::EventType::Complete});
+	}
+
+	Span(const Span &)            = delete;
+	Span &operator=(const Span &) = delete;
+
+      private:
+	const char    *name_;
+	details::u64   start_;
+};
+
+inline void instant(const char *name) noexcept
+{
+	details::record({name, details::ticks(), 0, details::EventType::Instant});
+}
+
+inline void counter(const char *name, double value) noexcept
+{
+	details::record({name, details::ticks(), std::bit_cast<details::u64>(value), details::EventType::Counter});
+}
+
+inline void set_thread_name(std::string_view name)
+{
+	if (details::stopped.load(std::memory_order_relaxed))
+		return;
+	auto *buf = details::tls_buffer;
+	if (!buf)
+		buf = details::tls_buffer = Tracer::inst().attach();
+	Tracer::inst().set_thread_name(buf, name);
+}
+
+inline void flush()
+{
+	if (!details::stopped.load(std::memory_order_relaxed))
+		Tracer::inst().flush();
+}
+
+inline void shutdown()
+{
+	if (!details::stopped.load(std::memory_order_relaxed))
+		Tracer::inst().shutdown();
+}
+
+} /* namespace trace */
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) ::trace::Span TRACE_CONCAT(trace_span_, __COUNTER__){name}
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#define TRACE_INSTANT(name) ::trace::instant(name)
+#define TRACE_COUNTER(name, value) ::trace::counter(name, static_cast<double>(value))
+#define TRACE_THREAD_NAME(name) ::trace::set_thread_name(name)
+#define TRACE_FLUSH() ::trace::flush()
+#else /* !USE_TRACE */
+/* Arguments are not evaluated but still count as used, so trace-only variables stay -Werror clean */
+#define TRACE_SCOPE(name) ((void)sizeof(name))
+#define TRACE_FUNCTION() ((void)0)
+#define TRACE_INSTANT(name) ((void)sizeof(name))
+#define TRACE_COUNTER(name, value) ((void)sizeof(name), (void)sizeof(value))
+#define TRACE_THREAD_NAME(name) ((void)sizeof(name))
+#define TRACE_FLUSH() ((void)0)
+#endif /* USE_TRACE */
+#elif !defined(__cplusplus)
+/* Tracing is C++ only; keep call sites portable across `prc set-std` */
+#define TRACE_SCOPE(name) ((void)sizeof(name))
+#define TRACE_FUNCTION() ((void)0)
+#define TRACE_INSTANT(name) ((void)sizeof(name))
+#define TRACE_COUNTER(name, value) ((void)sizeof(name), (void)sizeof(value))
+#define TRACE_THREAD_NAME(name) ((void)sizeof(name))
+#define TRACE_FLUSH() ((void)0)
+#endif
@@ -24,9 +24,11 @@ $(OBJ_DIR)/%.o : $(SRC_DIR)/%.cpp | $(OBJ_DIR) $(DEP_DIR)
 
 # Precompiled header rule
 ifeq ($(USE_PCH),yes)
-PCH_FILE := $(INCLUDE_DIR)/pch.hpp.gch
+# Built per flavor: GCC rejects a PCH compiled with different macros (e.g. TRACE)
+PCH_HEADER := $(INCLUDE_DIR)/pch.hpp
+PCH_FILE := $(OBJ_DIR)/$(notdir $(PCH_HEADER)).gch
 PCH_CXXFLAGS := -x c++-header -Winvalid-pch
-$(PCH_FILE): $(INCLUDE_DIR)/pch.hpp
+$(PCH_FILE): $(PCH_HEADER) | $(OBJ_DIR)
 	@echo -e "$(GREEN)[Generating PCH]$(RESET) $@"
 	$(CXX) $(PCH_CXXFLAGS) $(filter-out -Werror,$(CXXFLAGS)) \
 		$< -o $@
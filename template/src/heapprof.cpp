@@ -0,0 +1,595 @@
+/**
+  * @file heapprof.cpp
+  * @brief Sampling heap profiler, linked in only with `make HEAPPROF=yes`.
+  *
+  * malloc/calloc/realloc/free are intercepted with `-Wl,--wrap=` (C and C++),
+  * global operator new/delete are replaced on top of them (C++).
+  * Every allocation is counted per thread; one allocation per ~HEAPPROF_SAMPLE_BYTES
+  * (exponentially distributed, as pprof expects) gets its call stack captured by
+  * walking frame pointers and is attributed to a call site.
+  *
+  * On exit and on HEAPPROF_SIGNAL a profile is written to
+  * `HEAPPROF_FILE.<pid>.<seq>.heap` (pprof legacy heap_v2 format, e.g.
+  * `pprof -top ./app heapprof.1234.0001.heap`) along with a per-thread summary in
+  * `HEAPPROF_FILE.<pid>.<seq>.threads`.
+  *
+  * The hooks never allocate and the dump only uses async-signal-safe calls.
+  * Written in the C/C++ common subset so `prc set-std c17` keeps it working.
+  */
+/* vim: set noet tw=4 sw=4: */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* gettid() for C builds */
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__cplusplus)
+#include <new>
+#endif
+
+#include "core/typedefs.hpp"
+
+#if defined(__cplusplus)
+using namespace typedefs;
+#endif
+
+#ifndef HEAPPROF_FILE
+#define HEAPPROF_FILE "heapprof"
+#endif
+#ifndef HEAPPROF_SAMPLE_BYTES
+#define HEAPPROF_SAMPLE_BYTES (512 * 1024)
+#endif
+#ifndef HEAPPROF_SIGNAL
+#define HEAPPROF_SIGNAL SIGUSR2
+#endif
+#ifndef HEAPPROF_MAX_DEPTH
+#define HEAPPROF_MAX_DEPTH 32
+#endif
+#ifndef HEAPPROF_MAX_SITES
+#define HEAPPROF_MAX_SITES 4096 /* must be a power of 2 */
+#endif
+#ifndef HEAPPROF_MAX_LIVE
+#define HEAPPROF_MAX_LIVE (1 << 16) /* live sampled allocations, must be a power of 2 */
+#endif
+#ifndef HEAPPROF_MAX_THREADS
+#define HEAPPROF_MAX_THREADS 256
+#endif
+
+#define HP_NOINLINE __attribute__((noinline))
+#define HP_RELAXED __ATOMIC_RELAXED
+#define HP_BUCKET 8 /* live slots per bucket: one cache line of pointers */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+void *__real_malloc(usize size);
+void *__real_calloc(usize nmemb, usize size);
+void *__real_realloc(void *ptr, usize size);
+void  __real_free(void *ptr);
+void *__wrap_malloc(usize size);
+void *__wrap_calloc(usize nmemb, usize size);
+void *__wrap_realloc(void *ptr, usize size);
+void  __wrap_free(void *ptr);
+#if defined(__cplusplus)
+}
+#endif
+
+/**********************************************************
+* State
+**********************************************************/
+struct hp_site {
+	u64   hash;
+	u32   depth;
+	void *stack[HEAPPROF_MAX_DEPTH];
+	u64   alloc_count;
+	u64   alloc_bytes;
+	u64   live_count;
+	u64   live_bytes;
+};
+
+struct hp_thread {
+	s32 tid;
+	s32 shared; /* overflow slot written by several threads: needs atomic RMW */
+	u64 alloc_count;
+	u64 alloc_bytes;
+	u64 free_count;
+	u64 free_bytes;
+} __attribute__((aligned(64)));
+
+static struct hp_site   hp_sites[HEAPPROF_MAX_SITES];
+static u32              hp_site_index[HEAPPROF_MAX_SITES * 2]; /* site + 1, 0 is empty */
+static u32              hp_nsites;
+static char             hp_site_lock;
+
+static void            *hp_live_ptr[HEAPPROF_MAX_LIVE] __attribute__((aligned(64)));
+static u32              hp_live_site[HEAPPROF_MAX_LIVE];
+static u64              hp_live_size[HEAPPROF_MAX_LIVE];
+static u64              hp_live_dropped;
+
+static struct hp_thread hp_threads[HEAPPROF_MAX_THREADS];
+static u32              hp_nthreads;
+static u32              hp_dump_seq;
+
+static __thread struct hp_thread *hp_self;
+static __thread s64               hp_until_sample;
+static __thread u64               hp_rng;
+static __thread s32               hp_busy;
+
+/**********************************************************
+* Helpers
+**********************************************************/
+static inline u64 hp_hash_ptr(const void *p)
+{
+	u64 x = (u64)(uintptr_t)p;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static inline void hp_add(u64 *counter, u64 value, s32 shared)
+{
+	if (shared)
+		__atomic_fetch_add(counter, value, HP_RELAXED);
+	else /* single writer: no locked instruction on the hot path */
+		__atomic_store_n(counter, __atomic_load_n(counter, HP_RELAXED) + value, HP_RELAXED);
+}
+
+/**
+ * @brief Draws the next sampling distance from an exponential distribution with
+ * mean HEAPPROF_SAMPLE_BYTES, which is what pprof assumes when unsampling heap_v2.
+ */
+static s64 hp_next_sample(void)
+{
+	hp_rng ^= hp_rng << 13;
+	hp_rng ^= hp_rng >> 7;
+	hp_rng ^= hp_rng << 17;
+	const double u = (double)((hp_rng >> 11) + 1) / 9007199254740993.0; /* (0, 1] */
+	return (s64)(-log(u) * HEAPPROF_SAMPLE_BYTES) + 1;
+}
+
+static struct hp_thread *hp_thread_init(void)
+{
+	const u32 idx = __atomic_fetch_add(&hp_nthreads, 1, HP_RELAXED);
+	struct hp_thread *self;
+	if (idx < HEAPPROF_MAX_THREADS - 1) {
+		self = &hp_threads[idx];
+		self->tid = (s32)gettid();
+	} else { /* out of slots: threads share the last one */
+		self = &hp_threads[HEAPPROF_MAX_THREADS - 1];
+		self->shared = 1;
+		self->tid = -1;
+	}
+	hp_rng = hp_hash_ptr(&hp_rng) | 1;
+	hp_until_sample = hp_next_sample();
+	return self;
+}
+
+/**
+ * @brief Collects return addresses by following the frame-pointer chain.
+ * Stops on anything that does not look like a frame further up the same stack.
+ */
+static HP_NOINLINE u32 hp_backtrace(void **stack, u32 skip)
+{
+	void **fp = (void **)__builtin_frame_address(0);
+	u32 depth = 0;
+	while (fp && depth < HEAPPROF_MAX_DEPTH) {
+		void **next = (void **)fp[0];
+		void  *ret  = fp[1];
+		if (!ret)
+			break;
+		if (skip)
+			--skip;
+		else
+			stack[depth++] = ret;
+		if (next <= fp || (uintptr_t)next - (uintptr_t)fp > (1U << 20) || ((uintptr_t)next & 7U))
+			break;
+		fp = next;
+	}
+	return depth;
+}
+
+static u32 hp_site_get(void *const *stack, u32 depth)
+{
+	u64 hash = 0xcbf29ce484222325ULL;
+	for (u32 i = 0; i < depth; ++i)
+		hash = (hash ^ (u64)(uintptr_t)stack[i]) * 0x100000001b3ULL;
+
+	while (__atomic_test_and_set(&hp_site_lock, __ATOMIC_ACQUIRE))
+		;
+	u32 site = HEAPPROF_MAX_SITES;
+	for (u64 i = hash;; ++i) {
+		u32 *slot = &hp_site_index[i & (HEAPPROF_MAX_SITES * 2 - 1)];
+		if (*slot == 0) {
+			if (hp_nsites < HEAPPROF_MAX_SITES) {
+				site = hp_nsites;
+				hp_sites[site].hash  = hash;
+				hp_sites[site].depth = depth;
+				memcpy(hp_sites[site].stack, stack, depth * sizeof(void *));
+				*slot = site + 1;
+				/* Publish after the stack is written: the dump reads without the lock */
+				__atomic_store_n(&hp_nsites, site + 1, __ATOMIC_RELEASE);
+			}
+			break;
+		}
+		const struct hp_site *s = &hp_sites[*slot - 1];
+		if (s->hash == hash && s->depth == depth && !memcmp(s->stack, stack, depth * sizeof(void *))) {
+			site = *slot - 1;
+			break;
+		}
+	}
+	__atomic_clear(&hp_site_lock, __ATOMIC_RELEASE);
+	return site;
+}
+
+static HP_NOINLINE void hp_sample(void *ptr, usize size)
+{
+	void *stack[HEAPPROF_MAX_DEPTH];
+	/* Skip hp_sample, hp_alloc and the malloc wrapper */
+	const u32 depth = hp_backtrace(stack, 3);
+	const u32 site  = hp_site_get(stack, depth);
+	if (site == HEAPPROF_MAX_SITES)
+		return;
+
+	struct hp_site *s = &hp_sites[site];
+	__atomic_fetch_add(&s->alloc_count, 1, HP_RELAXED);
+	__atomic_fetch_add(&s->alloc_bytes, size, HP_RELAXED);
+
+	const u64 bucket = hp_hash_ptr(ptr) & (HEAPPROF_MAX_LIVE / HP_BUCKET - 1);
+	for (u32 i = 0; i < HP_BUCKET; ++i) {
+		const u64 slot = bucket * HP_BUCKET + i;
+		void *expected = NULL;
+		if (__atomic_compare_exchange_n(&hp_live_ptr[slot], &expected, ptr, 0, __ATOMIC_ACQ_REL,
+		                                HP_RELAXED)) {
+			/* ptr is not handed out yet, so nobody can free it before this is written */
+			hp_live_site[slot] = site;
+			hp_live_size[slot] = size;
+			__atomic_fetch_add(&s->live_count, 1, HP_RELAXED);
+			__atomic_fetch_add(&s->live_bytes, size, HP_RELAXED);
+			return;
+		}
+	}
+	__atomic_fetch_add(&hp_live_dropped, 1, HP_RELAXED);
+}
+
+static HP_NOINLINE void hp_alloc(void *ptr, usize size)
+{
+	if (!ptr || hp_busy)
+		return;
+	hp_busy = 1;
+	if (__builtin_expect(!hp_self, 0))
+		hp_self = hp_thread_init();
+	hp_add(&hp_self->alloc_count, 1, hp_self->shared);
+	hp_add(&hp_self->alloc_bytes, size, hp_self->shared);
+	hp_until_sample -= (s64)size;
+	if (__builtin_expect(hp_until_sample <= 0, 0)) {
+		hp_sample(ptr, size);
+		hp_until_sample = hp_next_sample();
+	}
+	hp_busy = 0;
+}
+
+static void hp_free(void *ptr)
+{
+	if (!ptr || hp_busy)
+		return;
+	hp_busy = 1;
+	if (__builtin_expect(!hp_self, 0))
+		hp_self = hp_thread_init();
+	hp_add(&hp_self->free_count, 1, hp_self->shared);
+	hp_add(&hp_self->free_bytes, malloc_usable_size(ptr), hp_self->shared);
+
+	const u64 bucket = hp_hash_ptr(ptr) & (HEAPPROF_MAX_LIVE / HP_BUCKET - 1);
+	for (u32 i = 0; i < HP_BUCKET; ++i) {
+		const u64 slot = bucket * HP_BUCKET + i;
+		if (__atomic_load_n(&hp_live_ptr[slot], HP_RELAXED) != ptr)
+			continue;
+		struct hp_site *s = &hp_sites[hp_live_site[slot]];
+		__atomic_fetch_sub(&s->live_count, 1, HP_RELAXED);
+		__atomic_fetch_sub(&s->live_bytes, hp_live_size[slot], HP_RELAXED);
+		__atomic_store_n(&hp_live_ptr[slot], NULL, __ATOMIC_RELEASE);
+		break;
+	}
+	hp_busy = 0;
+}
+
+/**********************************************************
+* Report (async-signal-safe)
+**********************************************************/
+struct hp_writer {
+	int   fd;
+	usize len;
+	char  buf[4096];
+};
+
+static void hp_flush(struct hp_writer *w)
+{
+	usize off = 0;
+	while (off < w->len) {
+		const ssize_t n = write(w->fd, w->buf + off, w->len - off);
+		if (n <= 0)
+			break;
+		off += (usize)n;
+	}
+	w->len = 0;
+}
+
+static void hp_put(struct hp_writer *w, const char *str, usize len)
+{
+	for (usize i = 0; i < len; ++i) {
+		if (w->len == sizeof(w->buf))
+			hp_flush(w);
+		w->buf[w->len++] = str[i];
+	}
+}
+
+static void hp_puts(struct hp_writer *w, const char *str) { hp_put(w, str, strlen(str)); }
+
+static void hp_put_num(struct hp_writer *w, u64 value, u32 base, u32 min_width)
+{
+	char tmp[24];
+	u32  n = 0;
+	do {
+		tmp[n++] = "0123456789abcdef"[value % base];
+		value /= base;
+	} while (value);
+	while (n < min_width)
+		tmp[n++] = '0';
+	while (n)
+		hp_put(w, &tmp[--n], 1);
+}
+
+static int hp_open(struct hp_writer *w, u32 seq, const char *ext)
+{
+	w->len = 0;
+	hp_puts(w, HEAPPROF_FILE ".");
+	hp_put_num(w, (u64)getpid(), 10, 0);
+	hp_puts(w, ".");
+	hp_put_num(w, seq, 10, 4);
+	hp_puts(w, ext);
+	hp_put(w, "", 1);
+	w->fd  = open(w->buf, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	w->len = 0;
+	return w->fd;
+}
+
+static void hp_write_heap(struct hp_writer *w)
+{
+	const u32 nsites = __atomic_load_n(&hp_nsites, __ATOMIC_ACQUIRE);
+	u64 live_count = 0, live_bytes = 0, alloc_count = 0, alloc_bytes = 0;
+	for (u32 i = 0; i < nsites; ++i) {
+		live_count  += __atomic_load_n(&hp_sites[i].live_count, HP_RELAXED);
+		live_bytes  += __atomic_load_n(&hp_sites[i].live_bytes, HP_RELAXED);
+		alloc_count += __atomic_load_n(&hp_sites[i].alloc_count, HP_RELAXED);
+		alloc_bytes += __atomic_load_n(&hp_sites[i].alloc_bytes, HP_RELAXED);
+	}
+
+	hp_puts(w, "heap profile: ");
+	hp_put_num(w, live_count, 10, 0);
+	hp_puts(w, ": ");
+	hp_put_num(w, live_bytes, 10, 0);
+	hp_puts(w, " [");
+	hp_put_num(w, alloc_count, 10, 0);
+	hp_puts(w, ": ");
+	hp_put_num(w, alloc_bytes, 10, 0);
+	hp_puts(w, "] @ heap_v2/");
+	hp_put_num(w, HEAPPROF_SAMPLE_BYTES, 10, 0);
+	hp_puts(w, "\n");
+
+	for (u32 i = 0; i < nsites; ++i) {
+		const struct hp_site *s = &hp_sites[i];
+		hp_put_num(w, __atomic_load_n(&s->live_count, HP_RELAXED), 10, 0);
+		hp_puts(w, ": ");
+		hp_put_num(w, __atomic_load_n(&s->live_bytes, HP_RELAXED), 10, 0);
+		hp_puts(w, " [");
+		hp_put_num(w, __atomic_load_n(&s->alloc_count, HP_RELAXED), 10, 0);
+		hp_puts(w, ": ");
+		hp_put_num(w, __atomic_load_n(&s->alloc_bytes, HP_RELAXED), 10, 0);
+		hp_puts(w, "] @");
+		for (u32 d = 0; d < s->depth; ++d) {
+			hp_puts(w, " 0x");
+			hp_put_num(w, (u64)(uintptr_t)s->stack[d], 16, 0);
+		}
+		hp_puts(w, "\n");
+	}
+
+	/* pprof needs the mappings to symbolize a PIE */
+	hp_puts(w, "\nMAPPED_LIBRARIES:\n");
+	hp_flush(w);
+	const int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+	if (maps < 0)
+		return;
+	ssize_t n;
+	while ((n = read(maps, w->buf, sizeof(w->buf))) > 0) {
+		w->len = (usize)n;
+		hp_flush(w);
+	}
+	close(maps);
+}
+
+static void hp_write_threads(struct hp_writer *w)
+{
+	u32 nthreads = __atomic_load_n(&hp_nthreads, HP_RELAXED);
+	if (nthreads > HEAPPROF_MAX_THREADS)
+		nthreads = HEAPPROF_MAX_THREADS;
+
+	hp_puts(w, "# tid alloc_count alloc_bytes free_count free_bytes(usable) (tid -1: threads past HEAPPROF_MAX_THREADS)\n");
+	for (u32 i = 0; i < HEAPPROF_MAX_THREADS; ++i) {
+		const struct hp_thread *t = &hp_threads[i];
+		if (i >= nthreads && !t->shared)
+			continue;
+		if (t->tid < 0)
+			hp_puts(w, "-1");
+		else
+			hp_put_num(w, (u64)t->tid, 10, 0);
+		const u64 *const cols[] = {&t->alloc_count, &t->alloc_bytes, &t->free_count, &t->free_bytes};
+		for (u32 c = 0; c < sizeof(cols) / sizeof(cols[0]); ++c) {
+			hp_puts(w, " ");
+			hp_put_num(w, __atomic_load_n(cols[c], HP_RELAXED), 10, 0);
+		}
+		hp_puts(w, "\n");
+	}
+	hp_puts(w, "# live samples not tracked (table full): ");
+	hp_put_num(w, __atomic_load_n(&hp_live_dropped, HP_RELAXED), 10, 0);
+	hp_puts(w, "\n");
+}
+
+static void hp_dump(void)
+{
+	const s32 busy = hp_busy;
+	hp_busy = 1; /* ignore anything allocated while dumping */
+	const u32 seq = __atomic_add_fetch(&hp_dump_seq, 1, HP_RELAXED);
+	struct hp_writer w;
+	if (hp_open(&w, seq, ".heap") >= 0) {
+		hp_write_heap(&w);
+		hp_flush(&w);
+		close(w.fd);
+	}
+	if (hp_open(&w, seq, ".threads") >= 0) {
+		hp_write_threads(&w);
+		hp_flush(&w);
+		close(w.fd);
+	}
+	hp_busy = busy;
+}
+
+static void hp_on_signal(int sig)
+{
+	(void)sig;
+	const int saved_errno = errno;
+	hp_dump();
+	errno = saved_errno;
+}
+
+__attribute__((constructor)) static void hp_init(void)
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = hp_on_signal;
+	sa.sa_flags   = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(HEAPPROF_SIGNAL, &sa, NULL);
+}
+
+__attribute__((destructor)) static void hp_fini(void) { hp_dump(); }
+
+/**********************************************************
+* malloc family (-Wl,--wrap=...)
+**********************************************************/
+HP_NOINLINE void *__wrap_malloc(usize size)
+{
+	void *ptr = __real_malloc(size);
+	hp_alloc(ptr, size);
+	return ptr;
+}
+
+HP_NOINLINE void *__wrap_calloc(usize nmemb, usize size)
+{
+	void *ptr = __real_calloc(nmemb, size);
+	hp_alloc(ptr, nmemb * size);
+	return ptr;
+}
+
+HP_NOINLINE void *__wrap_realloc(void *ptr, usize size)
+{
+	hp_free(ptr);
+	void *res = __real_realloc(ptr, size);
+	if (res)
+		hp_alloc(res, size);
+	else if (ptr && size) /* failed: the old block is still live */
+		hp_alloc(ptr, malloc_usable_size(ptr));
+	return res;
+}
+
+void __wrap_free(void *ptr)
+{
+	hp_free(ptr);
+	__real_free(ptr);
+}
+
+#if defined(__cplusplus)
+/**********************************************************
+* Global operator new/delete
+**********************************************************/
+/* Plain forms go through the wrapped malloc/free so they are counted once */
+void *operator new(usize size)
+{
+	for (;;) {
+		if (void *ptr = malloc(size ? size : 1))
+			return ptr;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](usize size) { return operator new(size); }
+
+void *operator new(usize size, const std::nothrow_t &) noexcept
+{
+	try {
+		return operator new(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void *operator new[](usize size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, usize) noexcept { free(ptr); }
+void operator delete[](void *ptr, usize) noexcept { free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { free(ptr); }
+
+/* aligned_alloc is not wrapped: these record and release by hand */
+void *operator new(usize size, std::align_val_t al)
+{
+	const auto align = static_cast<usize>(al);
+	for (;;) {
+		if (void *ptr = aligned_alloc(align, (size + align - 1) & ~(align - 1))) {
+			hp_alloc(ptr, size);
+			return ptr;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](usize size, std::align_val_t al) { return operator new(size, al); }
+
+void *operator new(usize size, std::align_val_t al, const std::nothrow_t &) noexcept
+{
+	try {
+		return operator new(size, al);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void *operator new[](usize size, std::align_val_t al, const std::nothrow_t &tag) noexcept
+{
+	return operator new(size, al, tag);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+	hp_free(ptr);
+	__real_free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t al) noexcept { operator delete(ptr, al); }
+void operator delete(void *ptr, usize, std::align_val_t al) noexcept { operator delete(ptr, al); }
+void operator delete[](void *ptr, usize, std::align_val_t al) noexcept { operator delete(ptr, al); }
+void operator delete(void *ptr, std::align_val_t al, const std::nothrow_t &) noexcept { operator delete(ptr, al); }
+void operator delete[](void *ptr, std::align_val_t al, const std::nothrow_t &) noexcept { operator delete(ptr, al); }
+#endif
@@ -7,11 +7,13 @@
 #include "pch.hpp"
 #else
 #include "util/logger.hpp"
+#include "util/trace.hpp"
 #endif
 
 int main(void)
 {
 	#if defined(__cplusplus)
+		TRACE_FUNCTION();
 		using namespace logger;
 		auto stdout_sink = std::make_shared<sinks::ostreamSink_MT>(std::cout);
 		stdout_sink->set_LogLevel(::LogLevel::Info);